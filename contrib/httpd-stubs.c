@@ -0,0 +1,29 @@
+/*
+ * Stand-ins for the httpd core symbols nsjail_config.c uses, so it can be
+ * linked into programs that run outside httpd (the config benchmark and
+ * the tests). Only numeric "#id" user and group names are understood.
+ */
+
+#include <stdlib.h>
+#include "nsjail_config.h"
+
+module AP_MODULE_DECLARE_DATA nsjail_module;
+AP_DECLARE_DATA unixd_config_rec ap_unixd_config;
+
+AP_DECLARE(const char *) ap_check_cmd_context(cmd_parms *cmd, unsigned forbidden)
+{
+    UNUSED(cmd);
+    UNUSED(forbidden);
+
+    return NULL;
+}
+
+AP_DECLARE(uid_t) ap_uname2id(const char *name)
+{
+    return (uid_t)atol(name[0] == '#' ? name + 1 : name);
+}
+
+AP_DECLARE(gid_t) ap_gname2id(const char *name)
+{
+    return (gid_t)atol(name[0] == '#' ? name + 1 : name);
+}
@@ -0,0 +1,167 @@
+/*
+ * Config merge microbenchmark for mod_nsjail.
+ *
+ * Builds the dir configs of a synthetic server the way httpd does (one
+ * server-level config, one per vhost merged over it, nested <Directory>
+ * and <Location> sections per vhost) by calling create_dir_config,
+ * merge_dir_config and the set_* handlers from nsjail_config.c directly,
+ * then times the per-request merge walk over a vhost's sections.
+ *
+ * Build:
+ *   cc -O2 -I. -I$(apxs -q INCLUDEDIR) $(apr-1-config --includes --cppflags) \
+ *      -o nsjail-config-bench contrib/nsjail-config-bench.c nsjail_config.c \
+ *      contrib/httpd-stubs.c $(apr-1-config --link-ld)
+ *
+ * Usage: nsjail-config-bench <vhosts> [dirs] [locations] [requests]
+ *
+ * Prints one JSON object. pool_bytes_per_vhost is the heap the config
+ * pool grew by while loading, divided by the vhost count. The pool has
+ * its own allocator so no memory is reused from other pools, and the
+ * heap is read with glibc's mallinfo2, so the field is only reported on
+ * glibc 2.33 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <apr_general.h>
+#include <apr_time.h>
+#include <apr_pools.h>
+#include <apr_allocator.h>
+#include "nsjail_config.h"
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define HAVE_MALLINFO2 1
+
+/* Bytes of heap in use, including chunks malloc serves with mmap. */
+static apr_size_t heap_in_use(void)
+{
+    struct mallinfo2 mi = mallinfo2();
+
+    return mi.uordblks + mi.hblkhd;
+}
+#endif
+
+static void fail(const char *what, const char *err)
+{
+    fprintf(stderr, "nsjail-config-bench: %s: %s\n", what, err);
+    exit(1);
+}
+
+int main(int argc, const char *const argv[])
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pconf, *ptrans;
+    command_rec rlimit_cmd = { "NsJailRLimitNProc", { NULL }, (void *)NSJAIL_RLIMIT_NPROC, RSRC_CONF | ACCESS_CONF, TAKE12, NULL };
+    cmd_parms cmd;
+    void *server_dconf;
+    void **sections;
+    apr_time_t start, loaded, merged;
+#ifdef HAVE_MALLINFO2
+    apr_size_t heap_before, heap_after;
+#endif
+    char uid[16], child_uid[16];
+    const char *err;
+    int vhosts, dirs, locations, requests, stride, v, d, n;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <vhosts> [dirs] [locations] [requests]\n", argv[0]);
+        return 2;
+    }
+    vhosts = atoi(argv[1]);
+    dirs = (argc > 2) ? atoi(argv[2]) : 2;
+    locations = (argc > 3) ? atoi(argv[3]) : 1;
+    requests = (argc > 4) ? atoi(argv[4]) : 1000000;
+    if (vhosts < 1 || dirs < 0 || locations < 0 || requests < 1) {
+        fprintf(stderr, "%s: counts must be positive\n", argv[0]);
+        return 2;
+    }
+
+    /* vhost lookup_defaults followed by its sections, in walk order */
+    stride = 1 + dirs + locations;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_allocator_create(&allocator);
+    apr_pool_create_ex(&pconf, NULL, NULL, allocator);
+    apr_allocator_owner_set(allocator, pconf);
+    apr_pool_create(&ptrans, NULL);
+    sections = malloc(sizeof(void *) * vhosts * stride);
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.pool = pconf;
+    cmd.temp_pool = pconf;
+    cmd.cmd = &rlimit_cmd;
+    cmd.info = rlimit_cmd.cmd_data;
+
+#ifdef HAVE_MALLINFO2
+    heap_before = heap_in_use();
+#endif
+    start = apr_time_now();
+
+    server_dconf = create_dir_config(pconf, NULL);
+    for (v = 0; v < vhosts; v++) {
+        void *vhost_dconf = create_dir_config(pconf, NULL);
+
+        create_config(pconf, NULL);
+
+        apr_snprintf(uid, sizeof(uid), "#%d", 1000 + v % 60000);
+        set_uidgid(&cmd, vhost_dconf, uid, uid);
+        set_groups(&cmd, vhost_dconf, uid);
+        if ((err = set_rlimit(&cmd, vhost_dconf, "50", NULL)) != NULL) {
+            fail("set_rlimit", err);
+        }
+
+        /* ap_fixup_virtual_hosts merges each vhost over the main server */
+        sections[v * stride] = merge_dir_config(pconf, server_dconf, vhost_dconf);
+
+        for (d = 0; d < dirs; d++) {
+            void *dir_dconf = create_dir_config(pconf, NULL);
+
+            apr_snprintf(child_uid, sizeof(child_uid), "#%d", 1000 + v % 60000 + d + 1);
+            set_uidgid(&cmd, dir_dconf, child_uid, uid);
+            sections[v * stride + 1 + d] = dir_dconf;
+        }
+        for (d = 0; d < locations; d++) {
+            void *loc_dconf = create_dir_config(pconf, NULL);
+
+            set_groups(&cmd, loc_dconf, "@none");
+            sections[v * stride + 1 + dirs + d] = loc_dconf;
+        }
+    }
+
+    loaded = apr_time_now();
+#ifdef HAVE_MALLINFO2
+    heap_after = heap_in_use();
+#endif
+
+    /* ap_directory_walk and ap_location_walk merge every matching section */
+    for (n = 0; n < requests; n++) {
+        void **walk = &sections[(n % vhosts) * stride];
+
+        void *per_dir = walk[0];
+
+        for (d = 1; d < stride; d++) {
+            per_dir = merge_dir_config(ptrans, per_dir, walk[d]);
+        }
+        apr_pool_clear(ptrans);
+    }
+
+    merged = apr_time_now();
+
+    printf("{ \"vhosts\": %d, \"dirs_per_vhost\": %d, \"locations_per_vhost\": %d, ", vhosts, dirs, locations);
+    printf("\"create_seconds\": %.6f, ", (double)(loaded - start) / APR_USEC_PER_SEC);
+    printf("\"merge_ns_per_request\": %.1f, ", (double)(merged - loaded) * 1000 / requests);
+    printf("\"merges_per_request\": %d", stride - 1);
+#ifdef HAVE_MALLINFO2
+    printf(", \"pool_bytes_per_vhost\": %lu", (unsigned long)((heap_after - heap_before) / vhosts));
+#endif
+    printf(" }\n");
+
+    free(sections);
+    apr_pool_destroy(ptrans);
+    apr_pool_destroy(pconf);
+    apr_terminate();
+
+    return 0;
+}
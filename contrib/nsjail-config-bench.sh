@@ -0,0 +1,127 @@
+#!/bin/sh
+#
+# Generate synthetic httpd configurations with many mod_nsjail vhosts and
+# time how long httpd takes to load them with `httpd -t`. When DRIVER is
+# set, also run the nsjail-config-bench.c driver for the same vhost count
+# to time create_dir_config and merge_dir_config directly.
+#
+# Usage: nsjail-config-bench.sh [vhosts ...]
+#
+#   HTTPD       httpd binary (default: httpd)
+#   MODULES     directory holding mod_nsjail.so and the mpm module
+#               (default: /usr/lib64/httpd/modules)
+#   MPM         mpm module to load (default: mpm_prefork)
+#   DIRS        <Directory> blocks per vhost, nested (default: 2)
+#   LOCATIONS   <Location> blocks per vhost (default: 1)
+#   OUTPUT      JSON report (default: bench_output.json)
+#   DRIVER      built nsjail-config-bench binary (default: none)
+#   REQUESTS    merge walks the driver times (default: 1000000)
+#
+# Only numeric ids are used in the generated configs, so no NSS lookups
+# are made and no network access is needed. Timing uses GNU time's -f
+# option, so /usr/bin/time must be GNU time.
+
+HTTPD=${HTTPD:-httpd}
+MODULES=${MODULES:-/usr/lib64/httpd/modules}
+MPM=${MPM:-mpm_prefork}
+DIRS=${DIRS:-2}
+LOCATIONS=${LOCATIONS:-1}
+OUTPUT=${OUTPUT:-bench_output.json}
+DRIVER=${DRIVER:-}
+REQUESTS=${REQUESTS:-1000000}
+
+VHOSTS=${*:-1000 10000 100000}
+
+# Modules built into httpd must not be loaded again.
+STATIC=$("$HTTPD" -l)
+
+WORKDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORKDIR"' EXIT
+
+generate()
+{
+    vhosts=$1
+    conf=$2
+
+    {
+        echo "ServerRoot $WORKDIR"
+        echo "ServerName bench.invalid"
+        echo "PidFile $WORKDIR/httpd.pid"
+        echo "ErrorLog $WORKDIR/error_log"
+        echo "Listen 127.0.0.1:8080"
+        echo "$STATIC" | grep -q "${MPM#mpm_}.c" || echo "LoadModule ${MPM}_module $MODULES/mod_${MPM}.so"
+        echo "$STATIC" | grep -q "mod_unixd.c" || echo "LoadModule unixd_module $MODULES/mod_unixd.so"
+        echo "LoadModule nsjail_module $MODULES/mod_nsjail.so"
+        echo "User #$(id -u)"
+        echo "Group #$(id -g)"
+        echo "MaxRequestsPerChild 1"
+        echo "RDefaultUidGid #65534 #65534"
+    } > "$conf"
+
+    awk -v vhosts="$vhosts" -v dirs="$DIRS" -v locations="$LOCATIONS" 'BEGIN {
+        for (v = 0; v < vhosts; v++) {
+            uid = 1000 + v % 60000
+            printf "<VirtualHost 127.0.0.1:8080>\n"
+            printf "  ServerName site%d.bench.invalid\n", v
+            printf "  RDocumentChRoot /srv/site%d /public_html\n", v
+            printf "  RUidGid #%d #%d\n", uid, uid
+            printf "  RGroups #%d\n", uid
+            printf "  NsJailRLimitNProc 50\n"
+            path = "/srv/site" v "/public_html"
+            for (d = 0; d < dirs; d++) {
+                path = path "/d" d
+                printf "  <Directory %s>\n    RUidGid #%d #%d\n  </Directory>\n", path, uid + d + 1, uid
+            }
+            for (l = 0; l < locations; l++) {
+                printf "  <Location /l%d>\n    RGroups @none\n  </Location>\n", l
+            }
+            printf "</VirtualHost>\n"
+        }
+    }' >> "$conf"
+}
+
+# Print "<seconds> <max rss kB>" for one configuration test run.
+measure()
+{
+    /usr/bin/time -f "%e %M" -o "$WORKDIR/time" "$HTTPD" -t -f "$1" > /dev/null 2>&1 || return 1
+    cat "$WORKDIR/time"
+}
+
+generate 0 "$WORKDIR/base.conf"
+base=$(measure "$WORKDIR/base.conf") || { echo "httpd -t failed on the base config" >&2; exit 1; }
+base_rss=${base#* }
+
+{
+    echo "{"
+    echo "  \"httpd\": \"$("$HTTPD" -v | sed -n 's/^Server version: //p')\","
+    echo "  \"dirs_per_vhost\": $DIRS,"
+    echo "  \"locations_per_vhost\": $LOCATIONS,"
+    echo "  \"base_rss_kb\": $base_rss,"
+    echo "  \"runs\": ["
+} > "$OUTPUT"
+
+sep=""
+for vhosts in $VHOSTS; do
+    generate "$vhosts" "$WORKDIR/bench.conf"
+    result=$(measure "$WORKDIR/bench.conf") || { echo "httpd -t failed with $vhosts vhosts" >&2; exit 1; }
+    seconds=${result% *}
+    rss=${result#* }
+    per_vhost=$(awk -v rss="$rss" -v base="$base_rss" -v n="$vhosts" 'BEGIN { printf "%.0f", (rss - base) * 1024 / n }')
+
+    driver=""
+    if [ -n "$DRIVER" ]; then
+        driver=$("$DRIVER" "$vhosts" "$DIRS" "$LOCATIONS" "$REQUESTS") || { echo "$DRIVER failed with $vhosts vhosts" >&2; exit 1; }
+        driver=", \"merge\": $driver"
+    fi
+
+    printf '%s    { "vhosts": %d, "load_seconds": %s, "max_rss_kb": %d, "rss_bytes_per_vhost": %d%s }' "$sep" "$vhosts" "$seconds" "$rss" "$per_vhost" "$driver" >> "$OUTPUT"
+    sep=",
+"
+    echo "$vhosts vhosts: ${seconds}s, ${per_vhost} RSS bytes/vhost" >&2
+done
+
+{
+    echo
+    echo "  ]"
+    echo "}"
+} >> "$OUTPUT"
@@ -45,6 +45,7 @@
 
 #include <unistd.h>
 #include <sys/prctl.h>
+#include <sys/mman.h>
 #include <sys/capability.h>
 #include "nsjail_config.h"
 
@@ -54,8 +55,6 @@
 #define NSJAIL_ENABLED	0
 #define NSJAIL_DISABLED	1
 
-#define UNUSED(x) (void)(x)
-
 /* added for apache 2.0 and 2.2 compatibility */
 #if !AP_MODULE_MAGIC_AT_LEAST(20081201,0)
 #define ap_unixd_config unixd_config
@@ -70,6 +69,12 @@ static const char *old_root;
 static gid_t startup_groups[NSJAIL_MAXGROUPS];
 static int startup_groupsnr;
 
+/* names of the NSJAIL_RLIMIT_* slots in the nsjail-rlimit-hit note */
+static const char *rlimit_names[NSJAIL_MAXRLIMITS] = { "as", "nproc", "nofile", "cpu" };
+
+/* bit per NSJAIL_RLIMIT_* slot that nsjail_set_rlimits applied in this child */
+static int rlimits_applied;
+
 
 /* configure options in httpd.conf */
 static const command_rec nsjail_cmds[] = {
@@ -83,10 +88,27 @@ static const command_rec nsjail_cmds[] = {
 	AP_INIT_TAKE1("NsJailUtsHostname", set_utshostname, NULL, RSRC_CONF | ACCESS_CONF, "Set hostname within UTS namespace."),
 	AP_INIT_TAKE1("NsJailUtsDomainName", set_utsdomainname, NULL, RSRC_CONF | ACCESS_CONF, "Set domain name within UTS namespace."),
 	AP_INIT_TAKE1("NsJailUtsCachePath", set_utscachepath, NULL, RSRC_CONF | ACCESS_CONF, "Set location to bind UTS namespace to."),
+	AP_INIT_TAKE12("NsJailRLimitAS", set_rlimit, (void *)NSJAIL_RLIMIT_AS, RSRC_CONF | ACCESS_CONF, "Set soft and hard RLIMIT_AS in bytes."),
+	AP_INIT_TAKE12("NsJailRLimitNProc", set_rlimit, (void *)NSJAIL_RLIMIT_NPROC, RSRC_CONF | ACCESS_CONF, "Set soft and hard RLIMIT_NPROC."),
+	AP_INIT_TAKE12("NsJailRLimitNoFile", set_rlimit, (void *)NSJAIL_RLIMIT_NOFILE, RSRC_CONF | ACCESS_CONF, "Set soft and hard RLIMIT_NOFILE."),
+	AP_INIT_TAKE12("NsJailRLimitCPU", set_rlimit, (void *)NSJAIL_RLIMIT_CPU, RSRC_CONF | ACCESS_CONF, "Set soft and hard RLIMIT_CPU in seconds."),
 	{NULL, {NULL}, NULL, 0, NO_ARGS, NULL}
 };
 
 
+/* run in pre config hook, once for every (re)start */
+static int nsjail_pre_config (apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
+{
+	UNUSED(p);
+	UNUSED(plog);
+	UNUSED(ptemp);
+
+	reset_used();
+
+	return OK;
+}
+
+
 /* run in post config hook ( we are parent process and we are uid 0) */
 static int nsjail_init (apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp, server_rec *s)
 {
@@ -109,11 +131,20 @@ static int nsjail_init (apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp, serv
 	} else {
 		ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, NULL, MODULE_NAME "/" MODULE_VERSION " enabled");
 
-		/* MaxRequestsPerChild MUST be 1 to enable mod_nsjail's functionality. */
+		/* MaxRequestsPerChild MUST be 1 to enable mod_nsjail's functionality.
+		 * Decide again on every restart, the setting may have changed. */
+		disabled = NSJAIL_DISABLED;
 		if (ap_max_requests_per_child == 1) {
 			ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, NULL, MODULE_NAME " enabled.");
 			disabled = NSJAIL_ENABLED;
 		}
+
+		/* CGI scripts are forked from the jailed child by mod_cgi and
+		 * inherit its chroot and uid/gid. mod_cgid spawns them from its
+		 * own daemon instead, which is never jailed. */
+		if (disabled == NSJAIL_ENABLED && ap_find_linked_module("mod_cgid.c") != NULL) {
+			ap_log_error(APLOG_MARK, APLOG_WARNING, 0, NULL, "%s mod_cgid is loaded, CGI scripts will run outside the jail. Use mod_cgi instead.", MODULE_NAME);
+		}
 	}
 
 	return OK;
@@ -152,6 +183,10 @@ static void nsjail_child_init (apr_pool_t *p, server_rec *s)
 	if (root_handle != UNSET) {
 		capval[ncap++] = CAP_SYS_CHROOT;
 	}
+	/* raising hard rlimits needs CAP_SYS_RESOURCE */
+	if (is_rlimit_used() == NSJAIL_RLIMIT_USED) {
+		capval[ncap++] = CAP_SYS_RESOURCE;
+	}
 	cap_set_flag(cap, CAP_PERMITTED, ncap, capval, CAP_SET);
 	if (cap_set_proc(cap) != 0) {
 		ap_log_error(APLOG_MARK, APLOG_ERR, 0, NULL, "%s CRITICAL ERROR %s:cap_set_proc failed", MODULE_NAME, __func__);
@@ -163,6 +198,33 @@ static void nsjail_child_init (apr_pool_t *p, server_rec *s)
 }
 
 
+/* apply the configured rlimits in slot order, returns the number of failures */
+static int nsjail_set_rlimits (request_rec *r, nsjail_dir_config_t *dconf, const char *from_func)
+{
+	int i, failed = 0;
+
+	for (i = 0; i < NSJAIL_MAXRLIMITS; i++) {
+		if (dconf->rlimits[i].resource == UNSET) {
+			continue;
+		}
+		ap_log_error (APLOG_MARK, APLOG_DEBUG, 0, NULL, "%s %s %s>%s:setrlimit(%d, %lu, %lu)", MODULE_NAME, ap_get_server_name(r), from_func, __func__, dconf->rlimits[i].resource, (unsigned long)dconf->rlimits[i].limit.rlim_cur, (unsigned long)dconf->rlimits[i].limit.rlim_max);
+		if (setrlimit(dconf->rlimits[i].resource, &dconf->rlimits[i].limit) != 0) {
+			ap_log_error (APLOG_MARK, APLOG_ERR, errno, NULL, "%s %s %s %s>%s:setrlimit(%d) failed", MODULE_NAME, ap_get_server_name(r), r->the_request, from_func, __func__, dconf->rlimits[i].resource);
+			failed++;
+		} else {
+			rlimits_applied |= 1 << i;
+		}
+	}
+
+	/* expose failures to mod_log_config as %{nsjail-rlimit-failed}n */
+	if (failed) {
+		apr_table_setn(r->notes, "nsjail-rlimit-failed", apr_itoa(r->pool, failed));
+	}
+
+	return failed;
+}
+
+
 static int nsjail_set_perm (request_rec *r, const char *from_func)
 {
 	/* MaxRequestsPerChild MUST be 1 to enable mod_nsjail's functionality. */
@@ -179,17 +241,21 @@ static int nsjail_set_perm (request_rec *r, const char *from_func)
 	gid_t groups[NSJAIL_MAXGROUPS];
 	int groupsnr;
 
+	int ncap;
 	cap_t cap;
-	cap_value_t capval[3];
+	cap_value_t capval[5];
 
 	/* TODO: De-magic-number this. NSJAIL_SETUIDGID_DISABLED/NSJAIL_SETUIDGID_ENABLED. */
-	if ( dconf->enable_setuidgid == 1 ) {
+	/* UNSET means NsJailEnableSetUidGid was never given, which defaults to On. */
+	if ( dconf->enable_setuidgid != 0 ) {
 
 		/* Ensure we have the capabilities CAP_SETUID and CAP_SETGID, and that they are effective. */
 		cap=cap_get_proc();
 		capval[0]=CAP_SETUID;
 		capval[1]=CAP_SETGID;
-		cap_set_flag(cap,CAP_EFFECTIVE,2,capval,CAP_SET);
+		ncap=2;
+		if (dconf->rlimitsnr > 0) capval[ncap++]=CAP_SYS_RESOURCE;
+		cap_set_flag(cap,CAP_EFFECTIVE,ncap,capval,CAP_SET);
 		if (cap_set_proc(cap)!=0) {
 			ap_log_error (APLOG_MARK, APLOG_ERR, 0, NULL, "%s CRITICAL ERROR %s>%s:cap_set_proc failed before setuid", MODULE_NAME, from_func, __func__);
 		}
@@ -229,6 +295,8 @@ static int nsjail_set_perm (request_rec *r, const char *from_func)
 		{
 			ap_log_error (APLOG_MARK, APLOG_ERR, 0, NULL, "%s %s %s %s>%s:setgid(%d) failed. getgid=%d getuid=%d", MODULE_NAME, ap_get_server_name(r), r->the_request, from_func, __func__, dconf->nsjail_gid, getgid(), getuid());
 			retval = HTTP_FORBIDDEN;
+		} else if (nsjail_set_rlimits(r, dconf, from_func) != 0) {
+			retval = HTTP_FORBIDDEN;
 		} else {
 			if (setuid(uid) != 0)
 			{
@@ -247,13 +315,31 @@ static int nsjail_set_perm (request_rec *r, const char *from_func)
 		capval[0]=CAP_SETUID;
 		capval[1]=CAP_SETGID;
 		capval[2]=CAP_DAC_READ_SEARCH;
-		cap_set_flag(cap,CAP_EFFECTIVE,3,capval,CAP_CLEAR);
+		capval[3]=CAP_SYS_RESOURCE;
+		cap_set_flag(cap,CAP_EFFECTIVE,4,capval,CAP_CLEAR);
 
 		if (cap_set_proc(cap)!=0) {
 			ap_log_error (APLOG_MARK, APLOG_ERR, 0, NULL, "%s CRITICAL ERROR %s>%s:cap_set_proc failed after setuid", MODULE_NAME, from_func, __func__);
 			retval = HTTP_FORBIDDEN;
 		}
 		cap_free(cap);
+
+		/* on failure the header parser hook never runs to drop the permitted
+		 * set, and the error document would be served with it still held */
+		if (retval == HTTP_FORBIDDEN) {
+			cap=cap_get_proc();
+			capval[0]=CAP_SETUID;
+			capval[1]=CAP_SETGID;
+			capval[2]=CAP_DAC_READ_SEARCH;
+			capval[3]=CAP_SYS_RESOURCE;
+			capval[4]=CAP_SYS_CHROOT;
+			cap_set_flag(cap,CAP_EFFECTIVE,5,capval,CAP_CLEAR);
+			cap_set_flag(cap,CAP_PERMITTED,5,capval,CAP_CLEAR);
+			if (cap_set_proc(cap)!=0) {
+				ap_log_error (APLOG_MARK, APLOG_ERR, 0, NULL, "%s CRITICAL ERROR %s>%s:cap_set_proc failed dropping capabilities", MODULE_NAME, from_func, __func__);
+			}
+			cap_free(cap);
+		}
 	}
 
 	return retval;
@@ -343,6 +429,7 @@ static int nsjail_uiiii (request_rec *r)
 		capval[2]=CAP_DAC_READ_SEARCH;
 		ncap = 2;
 		if (root_handle == UNSET) capval[ncap++] = CAP_SYS_CHROOT;
+		if (is_rlimit_used() == NSJAIL_RLIMIT_USED) capval[ncap++] = CAP_SYS_RESOURCE;
 		cap_set_flag(cap,CAP_PERMITTED,ncap,capval,CAP_CLEAR);
 
 		if (cap_set_proc(cap)!=0) {
@@ -356,14 +443,85 @@ static int nsjail_uiiii (request_rec *r)
 }
 
 
+/* run in log_transaction hook, before mod_log_config */
+static int nsjail_rlimit_hits (request_rec *r)
+{
+	if ( disabled == NSJAIL_DISABLED ) {
+		return DECLINED;
+	}
+
+	nsjail_dir_config_t *dconf = ap_get_module_config(r->per_dir_config, &nsjail_module);
+
+	const char *hits = NULL;
+	rlim_t cur;
+	void *probe;
+	long page;
+	int i, fd, hit;
+
+	/* only probe limits that were applied, NsJailEnableSetUidGid Off skips them */
+	if (rlimits_applied == 0) {
+		return DECLINED;
+	}
+
+	page = sysconf(_SC_PAGESIZE);
+
+	for (i = 0; i < NSJAIL_MAXRLIMITS; i++) {
+		cur = dconf->rlimits[i].limit.rlim_cur;
+		if (!(rlimits_applied & (1 << i)) || cur == RLIM_INFINITY) {
+			continue;
+		}
+
+		hit = 0;
+		switch (i) {
+		case NSJAIL_RLIMIT_AS:
+			/* no room left for a single page */
+			probe = mmap(NULL, page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (probe == MAP_FAILED) {
+				hit = (errno == ENOMEM);
+			} else {
+				munmap(probe, page);
+			}
+			break;
+		case NSJAIL_RLIMIT_NOFILE:
+			/* no descriptor left */
+			fd = dup(STDERR_FILENO);
+			if (fd == -1) {
+				hit = (errno == EMFILE);
+			} else {
+				close(fd);
+			}
+			break;
+		default:
+			/* RLIMIT_NPROC only shows up as a failed fork in the script, and
+			 * a process over RLIMIT_CPU is killed by SIGXCPU before it logs */
+			break;
+		}
+
+		if (hit) {
+			hits = (hits == NULL) ? rlimit_names[i] : apr_pstrcat(r->pool, hits, ",", rlimit_names[i], NULL);
+		}
+	}
+
+	/* expose hits to mod_log_config as %{nsjail-rlimit-hit}n */
+	if (hits != NULL) {
+		apr_table_setn(r->notes, "nsjail-rlimit-hit", hits);
+		ap_log_error (APLOG_MARK, APLOG_NOTICE, 0, NULL, "%s %s %s rlimit hit: %s", MODULE_NAME, ap_get_server_name(r), r->the_request, hits);
+	}
+
+	return DECLINED;
+}
+
+
 static void register_hooks (apr_pool_t *p)
 {
 	UNUSED(p);
 
+	ap_hook_pre_config (nsjail_pre_config, NULL, NULL, APR_HOOK_MIDDLE);
 	ap_hook_post_config (nsjail_init, NULL, NULL, APR_HOOK_MIDDLE);
 	ap_hook_child_init (nsjail_child_init, NULL, NULL, APR_HOOK_MIDDLE);
 	ap_hook_post_read_request(nsjail_setup, NULL, NULL, APR_HOOK_MIDDLE);
 	ap_hook_header_parser(nsjail_uiiii, NULL, NULL, APR_HOOK_FIRST);
+	ap_hook_log_transaction(nsjail_rlimit_hits, NULL, NULL, APR_HOOK_FIRST);
 }
 
 
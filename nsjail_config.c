@@ -1,17 +1,32 @@
 #include "nsjail_config.h"
 
 int chroot_used = NSJAIL_CHROOT_NOT_USED;
+int rlimit_used = NSJAIL_RLIMIT_NOT_USED;
+
+/* Resource for each NSJAIL_RLIMIT_* slot. */
+static const int nsjail_rlimit_resources[NSJAIL_MAXRLIMITS] = {
+    RLIMIT_AS,
+    RLIMIT_NPROC,
+    RLIMIT_NOFILE,
+    RLIMIT_CPU
+};
 
 void *create_dir_config(apr_pool_t * p, char *d)
 {
     char *dname = d;
+    int i;
     nsjail_dir_config_t *dconf = apr_pcalloc(p, sizeof(*dconf));
 
     /* TODO: De-magic-number this. NSJAIL_SETUIDGID_DISABLED/NSJAIL_SETUIDGID_ENABLED. */
-    dconf->enable_setuidgid = 1;
+    dconf->enable_setuidgid = UNSET;
     dconf->nsjail_uid = UNSET;
     dconf->nsjail_gid = UNSET;
     dconf->groupsnr = UNSET;
+    for (i = 0; i < NSJAIL_MAXRLIMITS; i++)
+    {
+        dconf->rlimits[i].resource = UNSET;
+    }
+    dconf->rlimitsnr = 0;
 
     return dconf;
 }
@@ -21,7 +36,9 @@ void *merge_dir_config(apr_pool_t *p, void *base, void *overrides)
     nsjail_dir_config_t *parent = base;
     nsjail_dir_config_t *child = overrides;
     nsjail_dir_config_t *conf = apr_pcalloc(p, sizeof(nsjail_dir_config_t));
+    int i;
 
+    conf->enable_setuidgid = (child->enable_setuidgid == UNSET) ? parent->enable_setuidgid : child->enable_setuidgid;
     conf->nsjail_uid = (child->nsjail_uid == UNSET) ? parent->nsjail_uid : child->nsjail_uid;
     conf->nsjail_gid = (child->nsjail_gid == UNSET) ? parent->nsjail_gid : child->nsjail_gid;
     if (child->groupsnr == NONE)
@@ -43,6 +60,16 @@ void *merge_dir_config(apr_pool_t *p, void *base, void *overrides)
         conf->groupsnr = (child->groupsnr == UNSET) ? parent->groupsnr : child->groupsnr;
     }
 
+    conf->rlimitsnr = 0;
+    for (i = 0; i < NSJAIL_MAXRLIMITS; i++)
+    {
+        conf->rlimits[i] = (child->rlimits[i].resource == UNSET) ? parent->rlimits[i] : child->rlimits[i];
+        if (conf->rlimits[i].resource != UNSET)
+        {
+            conf->rlimitsnr++;
+        }
+    }
+
     return conf;
 }
 
@@ -277,6 +304,101 @@ const char *set_utscachepath(cmd_parms *cmd, void *mconfig, const char *cache_pa
     return NULL;
 }
 
+/*
+ * Largest RLIMIT_NOFILE the kernel accepts, or RLIM_INFINITY if it can't
+ * be read.
+ */
+static rlim_t nr_open()
+{
+    FILE *f = fopen("/proc/sys/fs/nr_open", "r");
+    unsigned long value;
+    rlim_t limit = RLIM_INFINITY;
+
+    if (f != NULL)
+    {
+        if (fscanf(f, "%lu", &value) == 1)
+        {
+            limit = (rlim_t)value;
+        }
+        fclose(f);
+    }
+
+    return limit;
+}
+
+/*
+ * Configuration option.
+ * NsJailRLimitAS|NsJailRLimitNProc|NsJailRLimitNoFile|NsJailRLimitCPU <soft> [hard]
+ * soft: Soft limit, or "unlimited".
+ * hard: Hard limit, or "unlimited". Defaults to the soft limit.
+ */
+const char *set_rlimit(cmd_parms *cmd, void *mconfig, const char *soft, const char *hard) {
+    nsjail_dir_config_t *dconf = (nsjail_dir_config_t *)mconfig;
+    nsjail_rlimit_t *rlimit = &dconf->rlimits[(long)cmd->info];
+    const char *err = ap_check_cmd_context(cmd, NOT_IN_FILES | NOT_IN_LIMIT);
+    const char *arg;
+    rlim_t value[2];
+    char *end;
+    int i;
+
+    if (err != NULL)
+    {
+        return err;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        arg = (i == 0 || hard == NULL) ? soft : hard;
+        if (strcasecmp(arg, "unlimited") == 0)
+        {
+            value[i] = RLIM_INFINITY;
+            continue;
+        }
+        errno = 0;
+        value[i] = (rlim_t)apr_strtoi64(arg, &end, 10);
+        if (errno != 0 || end == arg || *end != '\0' || *arg == '-')
+        {
+            return apr_pstrcat(cmd->pool, cmd->cmd->name, " must be a non-negative number or 'unlimited': ", arg, NULL);
+        }
+    }
+
+    if (value[0] > value[1])
+    {
+        return apr_pstrcat(cmd->pool, cmd->cmd->name, " soft limit is larger than the hard limit", NULL);
+    }
+
+    /* setrlimit fails for every request if RLIMIT_NOFILE is above fs.nr_open */
+    if ((long)cmd->info == NSJAIL_RLIMIT_NOFILE && value[1] > nr_open())
+    {
+        return apr_pstrcat(cmd->pool, cmd->cmd->name, " hard limit is larger than fs.nr_open", NULL);
+    }
+
+    if (rlimit->resource == UNSET)
+    {
+        dconf->rlimitsnr++;
+    }
+    rlimit->resource = nsjail_rlimit_resources[(long)cmd->info];
+    rlimit->limit.rlim_cur = value[0];
+    rlimit->limit.rlim_max = value[1];
+    rlimit_used |= NSJAIL_RLIMIT_USED;
+
+    return NULL;
+}
+
 int is_chroot_used() {
     return chroot_used;
 }
+
+int is_rlimit_used() {
+    return rlimit_used;
+}
+
+/*
+ * Forget which features the previous configuration used. Statically
+ * linked modules keep their globals across restarts, so this must run
+ * before the directives are parsed again.
+ */
+void reset_used() {
+    chroot_used = NSJAIL_CHROOT_NOT_USED;
+    rlimit_used = NSJAIL_RLIMIT_NOT_USED;
+}
@@ -5,6 +5,9 @@
 #include <apr_md5.h>
 #include <apr_file_info.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <stdio.h>
 #include <unixd.h>
 
 // TODO: Override capability.
@@ -21,8 +24,26 @@
 #define NSJAIL_CHROOT_NOT_USED 0
 #define NSJAIL_CHROOT_USED 1
 
+#define NSJAIL_RLIMIT_NOT_USED 0
+#define NSJAIL_RLIMIT_USED 1
+
+/* Slots in nsjail_dir_config_t.rlimits, in the order they are applied. */
+#define NSJAIL_RLIMIT_AS 0
+#define NSJAIL_RLIMIT_NPROC 1
+#define NSJAIL_RLIMIT_NOFILE 2
+#define NSJAIL_RLIMIT_CPU 3
+#define NSJAIL_MAXRLIMITS 4
+
+#define UNUSED(x) (void)(x)
+
 // TODO: I don't know. Figure it out, you're the smart one.
-module AP_MODULE_DECLARE_DATA nsjail_module;
+extern module AP_MODULE_DECLARE_DATA nsjail_module;
+
+typedef struct
+{
+    int resource;
+    struct rlimit limit;
+} nsjail_rlimit_t;
 
 typedef struct
 {
@@ -35,6 +56,8 @@ typedef struct
     const char *uts_hostname;
     const char *uts_domainname;
     const char *uts_cachepath;
+    nsjail_rlimit_t rlimits[NSJAIL_MAXRLIMITS];
+    int rlimitsnr;
 } nsjail_dir_config_t;
 
 typedef struct
@@ -60,6 +83,9 @@ extern const char *set_enableutsnamespace(cmd_parms *, void *, int);
 extern const char *set_utshostname(cmd_parms *, void *, const char *);
 extern const char *set_utsdomainname(cmd_parms *, void *, const char *);
 extern const char *set_utscachepath(cmd_parms *, void *, const char *);
+extern const char *set_rlimit(cmd_parms *, void *, const char *, const char *);
 
 extern int is_chroot_used();
+extern int is_rlimit_used();
+extern void reset_used();
 #endif
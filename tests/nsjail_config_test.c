@@ -0,0 +1,142 @@
+/*
+ * Tests for the dir config handlers and merge in nsjail_config.c.
+ *
+ * Build and run:
+ *   cc -I. -I$(apxs -q INCLUDEDIR) $(apr-1-config --includes --cppflags) \
+ *      -o nsjail_config_test tests/nsjail_config_test.c nsjail_config.c \
+ *      contrib/httpd-stubs.c $(apr-1-config --link-ld) && ./nsjail_config_test
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <apr_general.h>
+#include <apr_pools.h>
+#include "nsjail_config.h"
+
+static int failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, __func__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static apr_pool_t *pool;
+static command_rec rlimit_cmds[NSJAIL_MAXRLIMITS] = {
+    { "NsJailRLimitAS", { NULL }, (void *)NSJAIL_RLIMIT_AS, RSRC_CONF | ACCESS_CONF, TAKE12, NULL },
+    { "NsJailRLimitNProc", { NULL }, (void *)NSJAIL_RLIMIT_NPROC, RSRC_CONF | ACCESS_CONF, TAKE12, NULL },
+    { "NsJailRLimitNoFile", { NULL }, (void *)NSJAIL_RLIMIT_NOFILE, RSRC_CONF | ACCESS_CONF, TAKE12, NULL },
+    { "NsJailRLimitCPU", { NULL }, (void *)NSJAIL_RLIMIT_CPU, RSRC_CONF | ACCESS_CONF, TAKE12, NULL }
+};
+
+static cmd_parms *make_cmd(int slot)
+{
+    cmd_parms *cmd = apr_pcalloc(pool, sizeof(*cmd));
+
+    cmd->pool = pool;
+    cmd->temp_pool = pool;
+    if (slot != UNSET) {
+        cmd->cmd = &rlimit_cmds[slot];
+        cmd->info = rlimit_cmds[slot].cmd_data;
+    }
+
+    return cmd;
+}
+
+/* The config nsjail_set_perm sees for a request in a <Directory> of a vhost. */
+static nsjail_dir_config_t *walk(nsjail_dir_config_t *server, nsjail_dir_config_t *vhost, nsjail_dir_config_t *dir)
+{
+    return merge_dir_config(pool, merge_dir_config(pool, server, vhost), dir);
+}
+
+static void test_vhost_rlimit_reaches_set_perm(void)
+{
+    nsjail_dir_config_t *server = create_dir_config(pool, NULL);
+    nsjail_dir_config_t *vhost = create_dir_config(pool, NULL);
+    nsjail_dir_config_t *dir = create_dir_config(pool, NULL);
+    nsjail_dir_config_t *conf;
+
+    CHECK(set_rlimit(make_cmd(NSJAIL_RLIMIT_NPROC), vhost, "50", NULL) == NULL);
+    set_uidgid(make_cmd(UNSET), dir, "#1001", "#1001");
+
+    conf = walk(server, vhost, dir);
+    CHECK(conf->enable_setuidgid != 0);
+    CHECK(conf->rlimits[NSJAIL_RLIMIT_NPROC].resource == RLIMIT_NPROC);
+    CHECK(conf->rlimits[NSJAIL_RLIMIT_NPROC].limit.rlim_cur == 50);
+    CHECK(conf->rlimits[NSJAIL_RLIMIT_NPROC].limit.rlim_max == 50);
+    CHECK(conf->rlimits[NSJAIL_RLIMIT_CPU].resource == UNSET);
+    CHECK(conf->rlimitsnr == 1);
+}
+
+static void test_enable_setuidgid_merge(void)
+{
+    nsjail_dir_config_t *server = create_dir_config(pool, NULL);
+    nsjail_dir_config_t *vhost = create_dir_config(pool, NULL);
+    nsjail_dir_config_t *dir = create_dir_config(pool, NULL);
+    nsjail_dir_config_t *subdir = create_dir_config(pool, NULL);
+    nsjail_dir_config_t *conf;
+
+    set_enablesetuidgid(make_cmd(UNSET), vhost, 0);
+    CHECK(walk(server, vhost, dir)->enable_setuidgid == 0);
+
+    set_enablesetuidgid(make_cmd(UNSET), subdir, 1);
+    conf = merge_dir_config(pool, walk(server, vhost, dir), subdir);
+    CHECK(conf->enable_setuidgid == 1);
+}
+
+static void test_rlimit_override_per_slot(void)
+{
+    nsjail_dir_config_t *vhost = create_dir_config(pool, NULL);
+    nsjail_dir_config_t *dir = create_dir_config(pool, NULL);
+    nsjail_dir_config_t *conf;
+
+    set_rlimit(make_cmd(NSJAIL_RLIMIT_CPU), vhost, "30", "60");
+    set_rlimit(make_cmd(NSJAIL_RLIMIT_NOFILE), vhost, "256", NULL);
+    set_rlimit(make_cmd(NSJAIL_RLIMIT_CPU), dir, "5", "unlimited");
+
+    conf = merge_dir_config(pool, vhost, dir);
+    CHECK(conf->rlimits[NSJAIL_RLIMIT_CPU].limit.rlim_cur == 5);
+    CHECK(conf->rlimits[NSJAIL_RLIMIT_CPU].limit.rlim_max == RLIM_INFINITY);
+    CHECK(conf->rlimits[NSJAIL_RLIMIT_NOFILE].limit.rlim_cur == 256);
+    CHECK(conf->rlimitsnr == 2);
+}
+
+static void test_rlimit_rejects_bad_values(void)
+{
+    nsjail_dir_config_t *dconf = create_dir_config(pool, NULL);
+
+    CHECK(set_rlimit(make_cmd(NSJAIL_RLIMIT_NOFILE), dconf, "", NULL) != NULL);
+    CHECK(set_rlimit(make_cmd(NSJAIL_RLIMIT_NOFILE), dconf, "-1", NULL) != NULL);
+    CHECK(set_rlimit(make_cmd(NSJAIL_RLIMIT_NOFILE), dconf, "10x", NULL) != NULL);
+    CHECK(set_rlimit(make_cmd(NSJAIL_RLIMIT_CPU), dconf, "60", "30") != NULL);
+    /* above fs.nr_open, setrlimit would fail on every request */
+    CHECK(set_rlimit(make_cmd(NSJAIL_RLIMIT_NOFILE), dconf, "unlimited", NULL) != NULL);
+    CHECK(set_rlimit(make_cmd(NSJAIL_RLIMIT_NOFILE), dconf, "1024", "99999999999") != NULL);
+    CHECK(dconf->rlimitsnr == 0);
+
+    CHECK(set_rlimit(make_cmd(NSJAIL_RLIMIT_NOFILE), dconf, "1024", NULL) == NULL);
+    CHECK(dconf->rlimitsnr == 1);
+}
+
+int main(int argc, const char *const argv[])
+{
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+    test_vhost_rlimit_reaches_set_perm();
+    test_enable_setuidgid_merge();
+    test_rlimit_override_per_slot();
+    test_rlimit_rejects_bad_values();
+
+    apr_pool_destroy(pool);
+    apr_terminate();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}